@@ -0,0 +1,97 @@
+#include "collision.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// 在立方体内随机生成小天体，密度保持不变，使平均邻居数不随规模变化
+// 其中fastFraction比例的天体速度放大fastFactor倍
+static std::vector<Body> genBodies(int n, unsigned int seed, float fastFraction = 0.0f, float fastFactor = 1.0f)
+{
+    std::mt19937 rng(seed);
+    float side = std::cbrt((float)n) * 10.0f;
+    std::uniform_real_distribution<float> posDist(0.0f, side);
+    std::uniform_real_distribution<float> velDist(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> radiusDist(0.1f, 1.0f);
+    std::uniform_real_distribution<float> unitDist(0.0f, 1.0f);
+    std::vector<Body> bodies(n);
+    for (auto &b : bodies)
+    {
+        b.prevPos = glm::vec3(posDist(rng), posDist(rng), posDist(rng));
+        b.vel = glm::vec3(velDist(rng), velDist(rng), velDist(rng));
+        if (unitDist(rng) < fastFraction)
+            b.vel = fastFactor * b.vel;
+        b.pos = b.prevPos + b.vel;
+        b.radius = radiusDist(rng);
+        b.mass = b.radius * b.radius * b.radius;
+        b.alive = true;
+    }
+    return bodies;
+}
+
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// 检测一组天体并与暴力检测对比，bruteForce为false时只计时
+static void runCase(const std::string &label, std::vector<Body> &bodies, float approach, bool bruteForce)
+{
+    CollisionSystem system;
+    system.approachDistance = approach;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    const std::vector<CollisionEvent> &events = system.step(bodies, 0.0f, 1.0f);
+    double hashMs = elapsedMs(start);
+
+    std::cout << label << "\t" << hashMs << "\t" << hashMs * 1.0e6 / bodies.size() << "\t";
+    if (bruteForce)
+    {
+        start = std::chrono::high_resolution_clock::now();
+        std::vector<CollisionEvent> brute = detectBruteForce(bodies, approach, 0.0f, 1.0f);
+        double bruteMs = elapsedMs(start);
+        bool match = brute.size() == events.size();
+        for (size_t i = 0; match && i < brute.size(); i++)
+            match = brute[i].a == events[i].a && brute[i].b == events[i].b && brute[i].type == events[i].type;
+        std::cout << bruteMs << "\t" << events.size() << "\t" << (match ? "yes" : "NO") << std::endl;
+    }
+    else
+    {
+        std::cout << "-\t" << events.size() << "\t-" << std::endl;
+    }
+}
+
+// 用法: CollisionBench [最大天体数] [暴力检测的最大天体数]
+int main(int argc, char **argv)
+{
+    int maxBodies = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int maxBrute = argc > 2 ? std::atoi(argv[2]) : 20000;
+    const float approach = 0.5f;
+    const float FAST_FACTOR = 50.0f;
+
+    std::cout << "bodies\thash(ms)\tns/body\tbrute(ms)\tevents\tmatch" << std::endl;
+    for (int n = 1000; n <= maxBodies; n *= 10)
+    {
+        std::vector<Body> bodies = genBodies(n, 42);
+        runCase(std::to_string(n), bodies, approach, n <= maxBrute);
+    }
+
+    // 一个天体在一步内穿过整个区域，不应拖垮网格
+    int n = std::min(10000, maxBodies);
+    std::vector<Body> bodies = genBodies(n, 7);
+    bodies[0].vel = glm::vec3(1.0e6f, 3.0e5f, -2.0e5f);
+    bodies[0].prevPos = bodies[0].pos - 0.5f * bodies[0].vel;
+    bodies[0].pos = bodies[0].pos + 0.5f * bodies[0].vel;
+    runCase(std::to_string(n) + "+fast", bodies, approach, n <= maxBrute);
+
+    // 固定比例的高速天体，耗时应随天体数线性增长
+    for (int n = 10000; n <= maxBodies; n *= 10)
+    {
+        std::vector<Body> bodies = genBodies(n, 11, 0.1f, FAST_FACTOR);
+        runCase(std::to_string(n) + "+10%fast", bodies, approach, n <= maxBrute);
+    }
+    return 0;
+}
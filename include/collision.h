@@ -0,0 +1,89 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <ostream>
+
+// 参与碰撞检测的天体
+// prevPos为上一步的位置，pos为当前位置，两步之间按匀速直线运动做连续扫掠检测
+struct Body
+{
+    glm::vec3 pos;
+    glm::vec3 prevPos;
+    glm::vec3 vel;
+    float radius;
+    float mass;
+    bool alive;
+};
+
+// 检测到的事件
+struct CollisionEvent
+{
+    enum Type
+    {
+        CloseApproach, // 近距离接近（表面间距小于approachDistance）
+        Impact         // 发生接触
+    };
+    Type type;
+    int a, b;       // 天体下标，a < b
+    float time;     // 发生时刻（最近点或首次接触的时刻）
+    float distance; // 该时刻的表面间距，撞击时为0
+};
+
+std::ostream &operator<<(std::ostream &os, const CollisionEvent &e);
+
+// 格子坐标：hi为(层级 << 32) | x，lo为(y << 32) | z，按元组比较
+struct CellKey
+{
+    uint64_t hi, lo;
+    bool operator<(const CellKey &o) const { return hi < o.hi || (hi == o.hi && lo < o.lo); }
+    bool operator==(const CellKey &o) const { return hi == o.hi && lo == o.lo; }
+    bool operator!=(const CellKey &o) const { return !(*this == o); }
+};
+
+// 基于分层排序网格(sort-based cell lists)的多线程宽相位 + 连续扫掠窄相位
+// 每层格子边长翻倍，大天体和高速天体放在较粗的层级中，沿扫掠路径登记格子
+class CollisionSystem
+{
+public:
+    float approachDistance = 0.0f; // 表面间距小于该值时记为近距离接近
+    float cellSize = 0.0f;         // 底层网格边长，<=0时按扫掠包围盒大小的中位数自动选取
+    bool mergeOnImpact = false;    // 撞击时按动量守恒合并两天体
+    unsigned int threads = 0;      // 工作线程数，0表示使用硬件线程数
+    size_t maxLogSize = 4096;      // 事件日志最多保留的条目
+
+    // 检测[t0, t1]这一步内的所有事件，返回本步事件（按a、b排序）
+    // 新出现的事件（上一步中该对天体没有同类事件）同时追加到事件日志中
+    const std::vector<CollisionEvent> &step(std::vector<Body> &bodies, float t0, float t1);
+
+    const std::deque<CollisionEvent> &log() const { return eventLog; }
+    void clearLog() { eventLog.clear(); }
+
+private:
+    struct CellEntry
+    {
+        CellKey key;
+        int body;
+        bool operator<(const CellEntry &o) const { return key < o.key || (key == o.key && body < o.body); }
+    };
+
+    std::vector<CellEntry> entries;
+    std::vector<glm::vec3> boxMin, boxMax;
+    std::vector<CollisionEvent> events;
+    std::vector<uint64_t> activePairs; // 上一步的(天体对, 事件类型)，已排序
+    std::deque<CollisionEvent> eventLog;
+
+    unsigned int workerCount() const;
+    void merge(std::vector<Body> &bodies);
+};
+
+// 窄相位：检测两天体在一步内的最近距离，若构成事件则写入e并返回true
+bool sweepTest(const Body &a, const Body &b, float approachDistance, float t0, float t1, CollisionEvent &e);
+
+// O(N^2)暴力检测，用于验证与性能对比
+std::vector<CollisionEvent> detectBruteForce(const std::vector<Body> &bodies, float approachDistance, float t0, float t1);
+
+#endif
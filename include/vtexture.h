@@ -0,0 +1,108 @@
+#ifndef VTEXTURE_H
+#define VTEXTURE_H
+
+#include <glad/glad.h>
+#include "shader.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 虚拟纹理：表面预先切成带边框的分页mip金字塔存放在磁盘上（见tools/vtbake.cpp），
+// 反馈pass统计可见的分页，后台线程异步解码，再上传到固定大小的物理缓存纹理中，
+// 着色器通过每个表面的页表(indirection)纹理找到分页在缓存中的位置。
+// 显存占用只取决于缓存槽位数，与原图大小无关。
+class VirtualTexture
+{
+public:
+    // slotsPerSide: 物理缓存每边的槽位数（<=255）
+    // pageSize/border: 分页大小与边框宽度（像素），需与切片时一致
+    // feedbackWidth/feedbackHeight: 反馈缓冲区大小
+    bool init(int slotsPerSide, int pageSize, int border, int feedbackWidth, int feedbackHeight);
+    // 加载dir下切好的表面，返回表面id（从1开始），失败返回0
+    int add(const std::string &dir);
+    // 每帧调用：处理上一帧的反馈，提交加载请求，上传解码完成的分页，更新页表
+    void update();
+    // 设置主着色器采样该表面所需的纹理和uniform
+    void bind(Shader &shader, int id);
+
+    // 反馈pass：begin/end之间用反馈着色器绘制场景，id为0表示不使用虚拟纹理的物体
+    void beginFeedback(Shader &shader);
+    void setFeedbackSurface(Shader &shader, int id);
+    void endFeedback();
+
+    void shutdown();
+
+private:
+    struct Surface
+    {
+        std::string dir;
+        int pagesX, pagesY, levels;
+        GLuint pageTable;
+        std::vector<std::vector<int>> resident;          // 每级每页所在槽位，-1表示不在缓存中
+        std::vector<std::vector<unsigned char>> table;   // 页表内容(RGBA: 槽位x, 槽位y, 级别, 255)
+        bool dirty;
+    };
+
+    struct Slot
+    {
+        int surface = -1;
+        int level = 0, x = 0, y = 0;
+        int lastUsed = -1;
+        bool locked = false;
+    };
+
+    struct Request
+    {
+        uint64_t key;
+        std::string path;
+    };
+
+    struct Tile
+    {
+        uint64_t key;
+        unsigned char *data;
+    };
+
+    int slotsPerSide = 0;
+    int pageSize = 0;
+    int border = 0;
+    int slotSize = 0;
+    GLuint physTex = 0;
+    std::vector<Slot> slots;
+    std::vector<Surface> surfaces;
+    std::set<uint64_t> pending;
+    std::set<uint64_t> failed;
+    int frame = 0;
+
+    // 反馈缓冲区，两个PBO轮流异步回读
+    int fbWidth = 0, fbHeight = 0;
+    GLuint feedbackFBO = 0;
+    GLuint feedbackColor = 0;
+    GLuint feedbackDepth = 0;
+    GLuint pbo[2] = {0, 0};
+    bool pboReady[2] = {false, false};
+    GLint savedViewport[4];
+
+    // 后台解码线程
+    std::vector<std::thread> workers;
+    std::deque<Request> requests;
+    std::deque<Tile> done;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool quit = false;
+
+    std::string tilePath(const Surface &s, int level, int x, int y) const;
+    unsigned char *loadTile(const std::string &path) const;
+    void workerLoop();
+    void readFeedback();
+    int allocSlot(bool locked);
+    void upload(int slot, int surface, int level, int x, int y, const unsigned char *data);
+    void rebuildTable(Surface &s);
+};
+
+#endif
@@ -0,0 +1,31 @@
+#version 330 core
+in vec2 TexCoord;
+in vec3 norm;
+in vec3 FragPos;
+
+// (页x, 页y, 级别, 表面id)，表面id为0表示不需要分页
+out uvec4 feedback;
+
+uniform int vtId;
+uniform vec2 vtPages;
+uniform float vtPageSize;
+uniform float vtMaxMip;
+uniform float mipBias;
+
+void main() {
+    if(vtId == 0) {
+        feedback = uvec4(0u);
+        return;
+    }
+    // 与shader.fs中的mip选择保持一致
+    vec2 texel = TexCoord * vtPages * vtPageSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float mip = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + mipBias, 0.0, vtMaxMip);
+
+    float level = floor(mip);
+    vec2 pages = vtPages / exp2(level);
+    vec2 uv = vec2(fract(TexCoord.x), clamp(TexCoord.y, 0.0, 0.99999));
+    vec2 page = min(floor(uv * pages), pages - 1.0);
+    feedback = uvec4(uvec2(page), uint(level), uint(vtId));
+}
@@ -13,12 +13,42 @@ uniform vec3 lightColor;
 uniform int background;
 uniform bool sun;
 
+// 虚拟纹理
+uniform bool virtualTex;
+uniform sampler2D pageTable;
+uniform sampler2D physTex;
+uniform vec2 vtPages;       // 第0级横向、纵向页数
+uniform float vtPageSize;   // 分页大小（像素）
+uniform float vtBorder;     // 分页边框（像素）
+uniform float vtMaxMip;
+uniform float vtPhysSize;   // 物理缓存纹理大小（像素）
+
+vec4 sampleVirtual(vec2 uv) {
+    // 按虚拟纹理的像素密度选择mip级别
+    vec2 texel = uv * vtPages * vtPageSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float mip = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, vtMaxMip);
+
+    // 页表给出分页所在的槽位和实际驻留的级别（缺失时为父分页）
+    uv.y = clamp(uv.y, 0.0, 0.99999);
+    vec4 entry = floor(textureLod(pageTable, uv, floor(mip)) * 255.0 + 0.5);
+    vec2 pages = vtPages / exp2(entry.b);
+    vec2 inPage = fract(uv * pages);
+    vec2 phys = (entry.rg * (vtPageSize + 2.0 * vtBorder) + vtBorder + inPage * vtPageSize) / vtPhysSize;
+    return textureLod(physTex, phys, 0.0);
+}
+
+vec4 sampleColor(vec2 uv) {
+    return virtualTex ? sampleVirtual(uv) : texture2D(ourTexture, uv);
+}
+
 void main() {
     //FragColor = vColor;
     if(background==1) {
         FragColor = 0.4 * texture2D(ourTexture, TexCoord);
     } else {
-        vec3 objectColor = vec3(texture2D(ourTexture, TexCoord));
+        vec3 objectColor = vec3(sampleColor(TexCoord));
 
     // ambient
         float ambientStrength = sun ? 1.0 : 0.3;
@@ -0,0 +1,463 @@
+#include "collision.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// 单个线程至少处理的元素个数，元素太少时直接在当前线程执行
+static const size_t MIN_GRAIN = 2048;
+
+// 扫掠路径最多分成的段数，超过时天体放到格子更大的层级中
+static const float MAX_PIECES = 64.0f;
+
+// 层级数上限，第L层的格子边长为底层的2^L倍
+static const int MAX_LEVEL = 31;
+
+// 格子坐标相对所有包围盒的最小角计算，每维最多2^31个格子
+static const double MAX_CELLS_PER_AXIS = 2147483648.0;
+
+// 将[0, n)分块并行执行fn(begin, end, worker)
+template <typename Fn>
+static void parallelFor(size_t n, unsigned int workers, Fn fn, size_t grain = MIN_GRAIN)
+{
+    size_t chunks = std::min<size_t>(workers, (n + grain - 1) / grain);
+    if (chunks <= 1)
+    {
+        fn(size_t(0), n, 0u);
+        return;
+    }
+    std::vector<std::thread> pool;
+    size_t per = (n + chunks - 1) / chunks;
+    for (unsigned int w = 1; w < chunks; w++)
+    {
+        size_t begin = w * per;
+        size_t end = std::min(n, begin + per);
+        pool.emplace_back([=, &fn]() { fn(begin, end, w); });
+    }
+    fn(size_t(0), std::min(n, per), 0u);
+    for (auto &t : pool)
+        t.join();
+}
+
+static uint32_t cellCoord(float x, float origin, float inv)
+{
+    return (uint32_t)std::max(0.0, std::floor((double)(x - origin) * inv));
+}
+
+static glm::uvec3 cellOf(const glm::vec3 &p, const glm::vec3 &origin, float inv)
+{
+    return glm::uvec3(cellCoord(p.x, origin.x, inv), cellCoord(p.y, origin.y, inv), cellCoord(p.z, origin.z, inv));
+}
+
+static CellKey cellKey(int level, uint32_t x, uint32_t y, uint32_t z)
+{
+    return {((uint64_t)level << 32) | x, ((uint64_t)y << 32) | z};
+}
+
+// 把扫掠路径均分成pieces段，每段的包围盒按半径r扩展后覆盖的第level层格子写入cells（已排序去重）
+// 两天体在某时刻足够接近时，两者连线上存在一点同时落在各自某一段的包围盒内，因此必有公共格子
+static void rasterize(const Body &b, float r, const glm::vec3 &boxMin, const glm::vec3 &boxMax, int pieces, int level,
+                      const glm::vec3 &origin, float inv, std::vector<CellKey> &cells)
+{
+    cells.clear();
+    glm::vec3 from = b.prevPos;
+    for (int j = 0; j < pieces; j++)
+    {
+        glm::vec3 to = j + 1 == pieces ? b.pos : b.prevPos + ((float)(j + 1) / pieces) * (b.pos - b.prevPos);
+        glm::vec3 lo = pieces == 1 ? boxMin : glm::min(from, to) - glm::vec3(r);
+        glm::vec3 hi = pieces == 1 ? boxMax : glm::max(from, to) + glm::vec3(r);
+        glm::uvec3 c0 = cellOf(lo, origin, inv), c1 = cellOf(hi, origin, inv);
+        for (uint32_t x = c0.x >> level; x <= c1.x >> level; x++)
+            for (uint32_t y = c0.y >> level; y <= c1.y >> level; y++)
+                for (uint32_t z = c0.z >> level; z <= c1.z >> level; z++)
+                    cells.push_back(cellKey(level, x, y, z));
+        from = to;
+    }
+    if (pieces > 1)
+    {
+        std::sort(cells.begin(), cells.end());
+        cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    }
+}
+
+static int piecesAt(float length, float cell)
+{
+    return std::max(1, (int)std::ceil(length / cell));
+}
+
+// 天体对与事件类型，接近升级为撞击时视为新事件
+static uint64_t eventKey(const CollisionEvent &e)
+{
+    return ((uint64_t)(uint32_t)e.a << 33) | ((uint64_t)(uint32_t)e.b << 1) | (uint64_t)e.type;
+}
+
+static bool eventLess(const CollisionEvent &x, const CollisionEvent &y)
+{
+    return x.a < y.a || (x.a == y.a && x.b < y.b);
+}
+
+std::ostream &operator<<(std::ostream &os, const CollisionEvent &e)
+{
+    os << (e.type == CollisionEvent::Impact ? "impact " : "close approach ")
+       << e.a << "-" << e.b << " t=" << e.time << " d=" << e.distance;
+    return os;
+}
+
+bool sweepTest(const Body &a, const Body &b, float approachDistance, float t0, float t1, CollisionEvent &e)
+{
+    // 相对运动 d(s) = d0 + s * v, s∈[0,1]
+    glm::vec3 d0 = b.prevPos - a.prevPos;
+    glm::vec3 v = (b.pos - a.pos) - d0;
+    float r = a.radius + b.radius;
+    float vv = glm::dot(v, v);
+    float dv = glm::dot(d0, v);
+    float s = vv > 0 ? std::max(0.0f, std::min(1.0f, -dv / vv)) : 0.0f;
+    float closest = glm::length(d0 + s * v);
+
+    if (closest <= r)
+    {
+        // 首次接触时刻：|d(s)| = r 的较小根
+        float dd = glm::dot(d0, d0) - r * r;
+        float hit = 0;
+        if (dd > 0 && vv > 0)
+        {
+            float disc = std::max(0.0f, dv * dv - vv * dd);
+            hit = std::max(0.0f, (-dv - std::sqrt(disc)) / vv);
+        }
+        e.type = CollisionEvent::Impact;
+        e.time = t0 + hit * (t1 - t0);
+        e.distance = 0;
+    }
+    else if (closest - r <= approachDistance)
+    {
+        e.type = CollisionEvent::CloseApproach;
+        e.time = t0 + s * (t1 - t0);
+        e.distance = closest - r;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+std::vector<CollisionEvent> detectBruteForce(const std::vector<Body> &bodies, float approachDistance, float t0, float t1)
+{
+    std::vector<CollisionEvent> result;
+    CollisionEvent e;
+    for (int i = 0; i < (int)bodies.size(); i++)
+    {
+        if (!bodies[i].alive)
+            continue;
+        for (int j = i + 1; j < (int)bodies.size(); j++)
+        {
+            if (bodies[j].alive && sweepTest(bodies[i], bodies[j], approachDistance, t0, t1, e))
+            {
+                e.a = i;
+                e.b = j;
+                result.push_back(e);
+            }
+        }
+    }
+    return result;
+}
+
+unsigned int CollisionSystem::workerCount() const
+{
+    if (threads > 0)
+        return threads;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+const std::vector<CollisionEvent> &CollisionSystem::step(std::vector<Body> &bodies, float t0, float t1)
+{
+    size_t n = bodies.size();
+    unsigned int workers = workerCount();
+    float margin = 0.5f * approachDistance;
+
+    // 1. 每个天体在本步内的扫掠包围盒
+    boxMin.resize(n);
+    boxMax.resize(n);
+    std::vector<float> extent(n, -1.0f);
+    std::vector<glm::vec3> lowest(workers, glm::vec3(INFINITY)), highest(workers, glm::vec3(-INFINITY));
+    parallelFor(n, workers, [&](size_t begin, size_t end, unsigned int w) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const Body &b = bodies[i];
+            glm::vec3 r(b.radius + margin);
+            boxMin[i] = glm::min(b.prevPos, b.pos) - r;
+            boxMax[i] = glm::max(b.prevPos, b.pos) + r;
+            if (b.alive)
+            {
+                glm::vec3 ext = boxMax[i] - boxMin[i];
+                extent[i] = std::max(ext.x, std::max(ext.y, ext.z));
+                lowest[w] = glm::min(lowest[w], boxMin[i]);
+                highest[w] = glm::max(highest[w], boxMax[i]);
+            }
+        }
+    });
+    glm::vec3 origin = lowest[0], top = highest[0];
+    for (unsigned int w = 1; w < workers; w++)
+    {
+        origin = glm::min(origin, lowest[w]);
+        top = glm::max(top, highest[w]);
+    }
+
+    // 按包围盒大小的中位数选取网格，不受少数高速或巨大天体影响
+    float cell = cellSize;
+    if (cell <= 0)
+    {
+        extent.erase(std::remove(extent.begin(), extent.end(), -1.0f), extent.end());
+        cell = 1.0f;
+        if (!extent.empty())
+        {
+            std::nth_element(extent.begin(), extent.begin() + extent.size() / 2, extent.end());
+            cell = 2.0f * extent[extent.size() / 2];
+        }
+        if (!(cell > 0))
+            cell = 1.0f;
+    }
+    // 分布范围极大时放大格子，保证坐标不越界
+    if (origin.x <= top.x)
+    {
+        glm::vec3 span = top - origin;
+        cell = std::max(cell, (float)(std::max(span.x, std::max(span.y, span.z)) / (MAX_CELLS_PER_AXIS - 1)));
+    }
+    float inv = 1.0f / cell;
+
+    // 2. 为每个天体选取层级：格子不小于天体直径，且扫掠路径不超过MAX_PIECES段
+    // 沿路径分段登记格子，高速天体只占据路径附近的格子而不是整个包围盒
+    std::vector<int> level(n, 0), pieces(n, 0);
+    std::vector<std::vector<CellEntry>> parts(workers);
+    std::vector<uint64_t> levelMask(workers, 0);
+    parallelFor(n, workers, [&](size_t begin, size_t end, unsigned int w) {
+        std::vector<CellKey> cells;
+        parts[w].clear();
+        for (size_t i = begin; i < end; i++)
+        {
+            const Body &b = bodies[i];
+            if (!b.alive)
+                continue;
+            float r = b.radius + margin;
+            float length = glm::length(b.pos - b.prevPos);
+            float c = cell;
+            int l = 0;
+            while (l < MAX_LEVEL && (c < 2 * r || length > MAX_PIECES * c))
+            {
+                l++;
+                c *= 2;
+            }
+            level[i] = l;
+            pieces[i] = piecesAt(length, c);
+            levelMask[w] |= uint64_t(1) << l;
+            rasterize(b, r, boxMin[i], boxMax[i], pieces[i], l, origin, inv, cells);
+            for (const CellKey &key : cells)
+                parts[w].push_back({key, (int)i});
+        }
+    });
+    uint64_t usedLevels = 0;
+    std::vector<size_t> partStart(workers + 1, 0);
+    for (unsigned int w = 0; w < workers; w++)
+    {
+        usedLevels |= levelMask[w];
+        partStart[w + 1] = partStart[w] + parts[w].size();
+    }
+    entries.resize(partStart[workers]);
+    parallelFor(workers, workers, [&](size_t begin, size_t end, unsigned int) {
+        for (size_t w = begin; w < end; w++)
+            std::copy(parts[w].begin(), parts[w].end(), entries.begin() + partStart[w]);
+    }, 1);
+
+    // 3. 分块并行排序后两两归并，使同一格子的天体相邻
+    size_t m = entries.size();
+    size_t chunks = std::max<size_t>(1, std::min<size_t>(workers, m / MIN_GRAIN));
+    size_t per = std::max<size_t>(1, (m + chunks - 1) / chunks);
+    parallelFor(chunks, chunks, [&](size_t begin, size_t end, unsigned int) {
+        for (size_t c = begin; c < end; c++)
+            std::sort(entries.begin() + std::min(m, c * per), entries.begin() + std::min(m, (c + 1) * per));
+    }, 1);
+    for (size_t width = per; width < m; width *= 2)
+    {
+        size_t merges = (m + 2 * width - 1) / (2 * width);
+        std::vector<std::thread> pool;
+        for (size_t c = 0; c < merges; c++)
+        {
+            size_t lo = c * 2 * width, mid = std::min(m, lo + width), hi = std::min(m, lo + 2 * width);
+            if (mid >= hi)
+                continue;
+            auto job = [this, lo, mid, hi]() {
+                std::inplace_merge(entries.begin() + lo, entries.begin() + mid, entries.begin() + hi);
+            };
+            if (c + 1 < merges && pool.size() + 1 < workers)
+                pool.emplace_back(job);
+            else
+                job();
+        }
+        for (auto &t : pool)
+            t.join();
+    }
+
+    // 4. 找出每个格子的起点，按格子并行检测同一层级的天体对
+    std::vector<size_t> cellStart;
+    for (size_t i = 0; i < m; i++)
+    {
+        if (i == 0 || entries[i].key != entries[i - 1].key)
+            cellStart.push_back(i);
+    }
+    cellStart.push_back(m);
+
+    std::vector<std::vector<CollisionEvent>> found(workers);
+    parallelFor(cellStart.size() - 1, workers, [&](size_t begin, size_t end, unsigned int w) {
+        CollisionEvent e;
+        for (size_t c = begin; c < end; c++)
+        {
+            for (size_t i = cellStart[c]; i < cellStart[c + 1]; i++)
+            {
+                int a = entries[i].body;
+                for (size_t j = i + 1; j < cellStart[c + 1]; j++)
+                {
+                    int b = entries[j].body;
+                    glm::vec3 lo = glm::max(boxMin[a], boxMin[b]);
+                    glm::vec3 hi = glm::min(boxMax[a], boxMax[b]);
+                    if (lo.x > hi.x || lo.y > hi.y || lo.z > hi.z)
+                        continue;
+                    // 两者都按整个包围盒登记时，同一对天体只在重叠区域最小角所在的格子里处理
+                    // 分段登记的天体对可能在多个格子中重复出现，最后统一去重
+                    if (pieces[a] == 1 && pieces[b] == 1)
+                    {
+                        glm::uvec3 owner = cellOf(lo, origin, inv);
+                        int l = level[a];
+                        if (cellKey(l, owner.x >> l, owner.y >> l, owner.z >> l) != entries[i].key)
+                            continue;
+                    }
+                    if (sweepTest(bodies[a], bodies[b], approachDistance, t0, t1, e))
+                    {
+                        e.a = a;
+                        e.b = b;
+                        found[w].push_back(e);
+                    }
+                }
+            }
+        }
+    });
+
+    // 每个天体在更高的层级中按该层的格子重新分段，查找与其共享格子的天体
+    std::vector<size_t> levelBegin(MAX_LEVEL + 2, m);
+    for (int l = MAX_LEVEL; l >= 0; l--)
+    {
+        levelBegin[l] = levelBegin[l + 1];
+        if (usedLevels & (uint64_t(1) << l))
+        {
+            CellKey first = cellKey(l, 0, 0, 0);
+            levelBegin[l] = std::lower_bound(entries.begin(), entries.end(), first, [](const CellEntry &x, const CellKey &k) {
+                return x.key < k;
+            }) - entries.begin();
+        }
+    }
+    if (usedLevels & (usedLevels - 1))
+    {
+        parallelFor(n, workers, [&](size_t begin, size_t end, unsigned int w) {
+            CollisionEvent e;
+            std::vector<CellKey> cells;
+            std::vector<int> candidates;
+            for (size_t i = begin; i < end; i++)
+            {
+                const Body &body = bodies[i];
+                if (!body.alive)
+                    continue;
+                float r = body.radius + margin;
+                float length = glm::length(body.pos - body.prevPos);
+                candidates.clear();
+                for (int l = level[i] + 1; l <= MAX_LEVEL; l++)
+                {
+                    if (!(usedLevels & (uint64_t(1) << l)))
+                        continue;
+                    rasterize(body, r, boxMin[i], boxMax[i], piecesAt(length, std::ldexp(cell, l)), l, origin, inv, cells);
+                    auto first = entries.begin() + levelBegin[l], last = entries.begin() + levelBegin[l + 1];
+                    for (const CellKey &key : cells)
+                    {
+                        first = std::lower_bound(first, last, key, [](const CellEntry &x, const CellKey &k) {
+                            return x.key < k;
+                        });
+                        for (auto it = first; it != last && it->key == key; ++it)
+                            candidates.push_back(it->body);
+                    }
+                }
+                std::sort(candidates.begin(), candidates.end());
+                candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+                for (int other : candidates)
+                {
+                    glm::vec3 lo = glm::max(boxMin[i], boxMin[other]);
+                    glm::vec3 hi = glm::min(boxMax[i], boxMax[other]);
+                    if (lo.x > hi.x || lo.y > hi.y || lo.z > hi.z)
+                        continue;
+                    int a = std::min((int)i, other), b = std::max((int)i, other);
+                    if (sweepTest(bodies[a], bodies[b], approachDistance, t0, t1, e))
+                    {
+                        e.a = a;
+                        e.b = b;
+                        found[w].push_back(e);
+                    }
+                }
+            }
+        });
+    }
+
+    events.clear();
+    for (auto &f : found)
+        events.insert(events.end(), f.begin(), f.end());
+    std::sort(events.begin(), events.end(), eventLess);
+    events.erase(std::unique(events.begin(), events.end(), [](const CollisionEvent &x, const CollisionEvent &y) {
+        return x.a == y.a && x.b == y.b;
+    }), events.end());
+
+    // 5. 记录新出现的事件
+    std::vector<uint64_t> pairs;
+    pairs.reserve(events.size());
+    for (const auto &e : events)
+    {
+        uint64_t key = eventKey(e);
+        pairs.push_back(key);
+        if (!std::binary_search(activePairs.begin(), activePairs.end(), key))
+        {
+            eventLog.push_back(e);
+            if (eventLog.size() > maxLogSize)
+                eventLog.pop_front();
+        }
+    }
+    activePairs.swap(pairs);
+
+    if (mergeOnImpact)
+        merge(bodies);
+    return events;
+}
+
+void CollisionSystem::merge(std::vector<Body> &bodies)
+{
+    // 按撞击时间先后合并，已被合并的天体不再参与后续合并
+    std::vector<const CollisionEvent *> impacts;
+    for (const auto &e : events)
+    {
+        if (e.type == CollisionEvent::Impact)
+            impacts.push_back(&e);
+    }
+    std::sort(impacts.begin(), impacts.end(), [](const CollisionEvent *x, const CollisionEvent *y) {
+        return x->time < y->time;
+    });
+    for (const CollisionEvent *e : impacts)
+    {
+        Body &a = bodies[e->a];
+        Body &b = bodies[e->b];
+        if (!a.alive || !b.alive)
+            continue;
+        float mass = a.mass + b.mass;
+        float wa = mass > 0 ? a.mass / mass : 0.5f;
+        float wb = 1.0f - wa;
+        // 动量守恒、体积守恒
+        a.pos = wa * a.pos + wb * b.pos;
+        a.prevPos = wa * a.prevPos + wb * b.prevPos;
+        a.vel = wa * a.vel + wb * b.vel;
+        a.radius = std::cbrt(a.radius * a.radius * a.radius + b.radius * b.radius * b.radius);
+        a.mass = mass;
+        b.alive = false;
+    }
+}
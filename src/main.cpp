@@ -1,6 +1,8 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "shader.h"
+#include "collision.h"
+#include "vtexture.h"
 #include <stb/stb_image.h>
 #include <iostream>
 #include <vector>
@@ -92,6 +94,18 @@ unsigned int sunTex;
 unsigned int moonTex;
 unsigned int backTex;
 
+// 虚拟纹理，res/vt下有切好的分页时使用，否则使用整张贴图
+// 物理缓存每边16个槽位，共256页，(128 + 2 * 4) * 16 = 2176像素见方的RGBA8纹理（约18MB）
+const int VT_CACHE_SLOTS_PER_SIDE = 16;
+const int VT_PAGE_SIZE = 128;
+const int VT_BORDER = 4;
+const int VT_FEEDBACK_WIDTH = 160;
+const int VT_FEEDBACK_HEIGHT = 120;
+VirtualTexture vtSystem;
+int earthVT = 0;
+int moonVT = 0;
+Shader *feedbackShader = NULL;
+
 // 相机控制相关
 bool firstMouse = true;
 float lastX, lastY;
@@ -105,6 +119,34 @@ glm::vec3 cameraUp(0, 1, 0);
 
 int pause = 0;
 
+// 碰撞检测：0太阳 1地球 2月球
+CollisionSystem collisionSystem;
+std::vector<Body> bodies;
+float simTime = 0;
+
+void detectCollision(const glm::vec3 &earthPos, const glm::vec3 &moonPos)
+{
+    glm::vec3 pos[3] = {sunLight.pos, earthPos, moonPos};
+    bool first = bodies.empty();
+    if (first)
+    {
+        float radius[3] = {1.0f, 0.3f, 0.1f};
+        for (int i = 0; i < 3; i++)
+            bodies.push_back({pos[i], pos[i], glm::vec3(0.0f), radius[i], radius[i] * radius[i] * radius[i], true});
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        bodies[i].prevPos = first ? pos[i] : bodies[i].pos;
+        bodies[i].pos = pos[i];
+    }
+    collisionSystem.step(bodies, simTime, simTime + deltaTime);
+    simTime += deltaTime;
+    // 输出新出现的事件
+    for (const auto &e : collisionSystem.log())
+        std::cout << e << std::endl;
+    collisionSystem.clearLog();
+}
+
 void genSphere(float radius, int xSegment, int ySegment, bool uv, std::vector<float> &sphereVertices, std::vector<int> &sphereIndices)
 {
     // 进行球体顶点和三角面片的计算
@@ -152,6 +194,19 @@ void genSphere(float radius, int xSegment, int ySegment, bool uv, std::vector<fl
     }
 }
 
+void bindSurface(Shader &shader, int vt, unsigned int tex)
+{
+    if (vt)
+    {
+        vtSystem.bind(shader, vt);
+    }
+    else
+    {
+        shader.setBool("virtualTex", false);
+        glBindTexture(GL_TEXTURE_2D, tex);
+    }
+}
+
 void genTex(unsigned int *id, Image *img)
 {
 
@@ -172,19 +227,35 @@ Shader initial(void)
 
     stbi_set_flip_vertically_on_load(true);
     // tell stb_image.h to flip loaded texture's on the y-axis.
+    // 虚拟纹理
+    if (vtSystem.init(VT_CACHE_SLOTS_PER_SIDE, VT_PAGE_SIZE, VT_BORDER, VT_FEEDBACK_WIDTH, VT_FEEDBACK_HEIGHT))
+    {
+        earthVT = vtSystem.add("res/vt/earth");
+        moonVT = vtSystem.add("res/vt/moon");
+        if (!earthVT && !moonVT)
+            vtSystem.shutdown();
+    }
+
     // 图片
-    earthImg = new Image("res/earth.jpg");
+    if (!earthVT)
+        earthImg = new Image("res/earth.jpg");
     sunImg = new Image("res/sun.jpg");
-    moonImg = new Image("res/moon.jpg");
+    if (!moonVT)
+        moonImg = new Image("res/moon.jpg");
     backImg = new Image("res/background.jpg");
     // backImg->Print();
 
     // 图片
-    genTex(&earthTex, earthImg);
+    if (!earthVT)
+        genTex(&earthTex, earthImg);
     genTex(&sunTex, sunImg);
-    genTex(&moonTex, moonImg);
+    if (!moonVT)
+        genTex(&moonTex, moonImg);
     genTex(&backTex, backImg);
 
+    // 碰撞检测参数
+    collisionSystem.approachDistance = 0.05f;
+
     // 球vao设置
     std::vector<float> sphereVertices;
     std::vector<int> sphereIndices;
@@ -244,6 +315,8 @@ Shader initial(void)
     const char *fragmentShader = "shader/shader.fs";
 
     // 生成并编译着色器
+    if (earthVT || moonVT)
+        feedbackShader = new Shader(vertexShader, "shader/feedback.fs");
     Shader shaderProgram(vertexShader, fragmentShader);
     shaderProgram.use();
     // 设定点线面的属性
@@ -268,6 +341,10 @@ void Draw(Shader shaderProgram)
         moonRot += (float)0.1f;
     }
 
+    // 根据上一帧的反馈加载虚拟纹理分页
+    if (feedbackShader)
+        vtSystem.update();
+
     // 清空颜色缓冲和深度缓冲区
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -286,6 +363,7 @@ void Draw(Shader shaderProgram)
     shaderProgram.setVec3("lightColor", sunLight.color);
 
     // 贴图
+    shaderProgram.setBool("virtualTex", false);
     glBindTexture(GL_TEXTURE_2D, sunTex);
 
     // 当前不是背景
@@ -315,7 +393,7 @@ void Draw(Shader shaderProgram)
     shaderProgram.setMatrix4fv("model", glm::value_ptr(earthTrans));
 
     // 贴图
-    glBindTexture(GL_TEXTURE_2D, earthTex);
+    bindSurface(shaderProgram, earthVT, earthTex);
     glDrawElements(GL_TRIANGLES, ballSize, GL_UNSIGNED_INT, 0);
 
     // 绘制moon
@@ -324,9 +402,15 @@ void Draw(Shader shaderProgram)
     shaderProgram.setMatrix4fv("model", glm::value_ptr(moonTrans));
 
     // 贴图
-    glBindTexture(GL_TEXTURE_2D, moonTex);
+    bindSurface(shaderProgram, moonVT, moonTex);
     glDrawElements(GL_TRIANGLES, ballSize, GL_UNSIGNED_INT, 0);
 
+    // 碰撞检测
+    if (!(pause & 2))
+    {
+        detectCollision(glm::vec3(earthPos), glm::vec3(moonTrans * oriPos));
+    }
+
     // 绘制背景
     glBindVertexArray(backVAO); // 绑定VAO
 
@@ -340,6 +424,31 @@ void Draw(Shader shaderProgram)
     glBindTexture(GL_TEXTURE_2D, backTex);
     glDrawElements(GL_TRIANGLES, backSize, GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
+
+    // 虚拟纹理反馈pass：低分辨率绘制球体，记录每个像素需要的分页
+    if (feedbackShader)
+    {
+        vtSystem.beginFeedback(*feedbackShader);
+        feedbackShader->setMatrix4fv("view", glm::value_ptr(view));
+        feedbackShader->setMatrix4fv("projection", glm::value_ptr(projection));
+        glBindVertexArray(ballVAO);
+
+        vtSystem.setFeedbackSurface(*feedbackShader, 0);
+        feedbackShader->setMatrix4fv("model", glm::value_ptr(one));
+        glDrawElements(GL_TRIANGLES, ballSize, GL_UNSIGNED_INT, 0);
+
+        vtSystem.setFeedbackSurface(*feedbackShader, earthVT);
+        feedbackShader->setMatrix4fv("model", glm::value_ptr(earthTrans));
+        glDrawElements(GL_TRIANGLES, ballSize, GL_UNSIGNED_INT, 0);
+
+        vtSystem.setFeedbackSurface(*feedbackShader, moonVT);
+        feedbackShader->setMatrix4fv("model", glm::value_ptr(moonTrans));
+        glDrawElements(GL_TRIANGLES, ballSize, GL_UNSIGNED_INT, 0);
+
+        glBindVertexArray(0);
+        vtSystem.endFeedback();
+        shaderProgram.use();
+    }
 }
 
 void reshaper(GLFWwindow *window, int width, int height)
@@ -487,6 +596,8 @@ void run(GLFWwindow *window, float fps)
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glDeleteVertexArrays(1, &ballVAO);
     glDeleteBuffers(1, &ballVBO);
+    vtSystem.shutdown();
+    delete feedbackShader;
 }
 
 int main()
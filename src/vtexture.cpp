@@ -0,0 +1,464 @@
+#include "vtexture.h"
+#include <stb/stb_image.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+// 同时在途（含解码完成等待槽位）的分页数和每帧最多上传的分页数
+static const size_t MAX_PENDING = 32;
+static const int MAX_UPLOADS = 8;
+static const int LOADER_THREADS = 2;
+
+static uint64_t tileKey(int surface, int level, int x, int y)
+{
+    return ((uint64_t)surface << 48) | ((uint64_t)level << 40) | ((uint64_t)x << 20) | (uint64_t)y;
+}
+
+static void splitKey(uint64_t key, int &surface, int &level, int &x, int &y)
+{
+    surface = (int)(key >> 48);
+    level = (int)((key >> 40) & 0xff);
+    x = (int)((key >> 20) & 0xfffff);
+    y = (int)(key & 0xfffff);
+}
+
+bool VirtualTexture::init(int slotsPerSide, int pageSize, int border, int feedbackWidth, int feedbackHeight)
+{
+    if (slotsPerSide <= 0 || slotsPerSide > 255)
+    {
+        std::cout << "ERROR::VTEXTURE::INVALID_SLOT_COUNT: " << slotsPerSide << std::endl;
+        return false;
+    }
+    this->slotsPerSide = slotsPerSide;
+    this->pageSize = pageSize;
+    this->border = border;
+    slotSize = pageSize + 2 * border;
+    slots.assign(slotsPerSide * slotsPerSide, Slot());
+
+    // 物理缓存纹理，分页自带边框，所以不需要mipmap
+    glGenTextures(1, &physTex);
+    glBindTexture(GL_TEXTURE_2D, physTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, slotsPerSide * slotSize, slotsPerSide * slotSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    // 反馈缓冲区：RGBA16UI存(页x, 页y, 级别, 表面id)
+    fbWidth = feedbackWidth;
+    fbHeight = feedbackHeight;
+    glGenFramebuffers(1, &feedbackFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+    glGenRenderbuffers(1, &feedbackColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, fbWidth, fbHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackColor);
+    glGenRenderbuffers(1, &feedbackDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, fbWidth, fbHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    if (!complete)
+    {
+        std::cout << "ERROR::VTEXTURE::FEEDBACK_FRAMEBUFFER_INCOMPLETE" << std::endl;
+        shutdown();
+        return false;
+    }
+
+    glGenBuffers(2, pbo);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, fbWidth * fbHeight * 4 * sizeof(GLushort), NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    quit = false;
+    for (int i = 0; i < LOADER_THREADS; i++)
+        workers.emplace_back(&VirtualTexture::workerLoop, this);
+    return true;
+}
+
+int VirtualTexture::add(const std::string &dir)
+{
+    // info.txt: 分页大小 边框 第0级横向页数 纵向页数 级数
+    std::ifstream info(dir + "/info.txt");
+    int infoPage, infoBorder;
+    Surface s;
+    if (!(info >> infoPage >> infoBorder >> s.pagesX >> s.pagesY >> s.levels))
+        return 0;
+    if (infoPage != pageSize || infoBorder != border || s.levels <= 0 || s.levels > 255 ||
+        (s.pagesX >> (s.levels - 1)) <= 0 || (s.pagesY >> (s.levels - 1)) <= 0)
+    {
+        std::cout << "ERROR::VTEXTURE::INFO_MISMATCH: " << dir << std::endl;
+        return 0;
+    }
+    s.dir = dir;
+    s.dirty = true;
+    for (int l = 0; l < s.levels; l++)
+    {
+        int w = s.pagesX >> l, h = s.pagesY >> l;
+        s.resident.push_back(std::vector<int>(w * h, -1));
+        s.table.push_back(std::vector<unsigned char>(w * h * 4, 0));
+    }
+
+    // 最粗一级常驻缓存，保证任何位置都有可用的分页
+    int top = s.levels - 1;
+    int topW = s.pagesX >> top, topH = s.pagesY >> top;
+    int id = (int)surfaces.size() + 1;
+    std::vector<int> locked;
+    for (int y = 0; y < topH; y++)
+    {
+        for (int x = 0; x < topW; x++)
+        {
+            unsigned char *data = loadTile(tilePath(s, top, x, y));
+            int slot = data ? allocSlot(true) : -1;
+            if (slot < 0)
+            {
+                std::cout << "ERROR::VTEXTURE::TILE_NOT_LOADED: " << tilePath(s, top, x, y) << std::endl;
+                stbi_image_free(data);
+                for (int l : locked)
+                    slots[l] = Slot();
+                return 0;
+            }
+            locked.push_back(slot);
+            s.resident[top][y * topW + x] = slot;
+            upload(slot, id, top, x, y, data);
+            stbi_image_free(data);
+        }
+    }
+
+    glGenTextures(1, &s.pageTable);
+    glBindTexture(GL_TEXTURE_2D, s.pageTable);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, s.levels - 1);
+    for (int l = 0; l < s.levels; l++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, s.pagesX >> l, s.pagesY >> l, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    surfaces.push_back(s);
+    rebuildTable(surfaces.back());
+    return id;
+}
+
+std::string VirtualTexture::tilePath(const Surface &s, int level, int x, int y) const
+{
+    return s.dir + "/" + std::to_string(level) + "/" + std::to_string(x) + "_" + std::to_string(y) + ".jpg";
+}
+
+unsigned char *VirtualTexture::loadTile(const std::string &path) const
+{
+    int width, height, nrChannels;
+    unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
+    if (data && (width != slotSize || height != slotSize))
+    {
+        stbi_image_free(data);
+        data = NULL;
+    }
+    return data;
+}
+
+void VirtualTexture::workerLoop()
+{
+    while (true)
+    {
+        Request req;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return quit || !requests.empty(); });
+            if (quit)
+                return;
+            req = requests.front();
+            requests.pop_front();
+        }
+        unsigned char *data = loadTile(req.path);
+        std::lock_guard<std::mutex> lock(mutex);
+        done.push_back({req.key, data});
+    }
+}
+
+void VirtualTexture::update()
+{
+    readFeedback();
+
+    // 上传解码完成的分页
+    std::vector<Tile> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!done.empty() && (int)ready.size() < MAX_UPLOADS)
+        {
+            ready.push_back(done.front());
+            done.pop_front();
+        }
+    }
+    for (size_t i = 0; i < ready.size(); i++)
+    {
+        const Tile &t = ready[i];
+        int id, level, x, y;
+        splitKey(t.key, id, level, x, y);
+        Surface &s = surfaces[id - 1];
+        int idx = y * (s.pagesX >> level) + x;
+        if (!t.data)
+        {
+            // 加载失败的分页不再请求，继续使用父分页
+            pending.erase(t.key);
+            failed.insert(t.key);
+            std::cout << "ERROR::VTEXTURE::TILE_NOT_LOADED: " << tilePath(s, level, x, y) << std::endl;
+            continue;
+        }
+        if (s.resident[level][idx] < 0)
+        {
+            int slot = allocSlot(false);
+            if (slot < 0)
+            {
+                // 缓存中的分页本帧都在使用，剩下的分页放回队列等槽位空出，
+                // 它们仍占着pending名额，所以不会被重复请求和解码
+                std::lock_guard<std::mutex> lock(mutex);
+                done.insert(done.begin(), ready.begin() + i, ready.end());
+                break;
+            }
+            upload(slot, id, level, x, y, t.data);
+            slots[slot].lastUsed = frame;
+            s.resident[level][idx] = slot;
+            s.dirty = true;
+        }
+        pending.erase(t.key);
+        stbi_image_free(t.data);
+    }
+
+    for (Surface &s : surfaces)
+    {
+        if (s.dirty)
+            rebuildTable(s);
+    }
+    frame++;
+}
+
+void VirtualTexture::readFeedback()
+{
+    // 读取两帧前写入的PBO，传输早已完成，映射时不会阻塞
+    int index = (frame + 1) % 2;
+    if (!pboReady[index])
+        return;
+    pboReady[index] = false;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[index]);
+    const GLushort *pixels = (const GLushort *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, fbWidth * fbHeight * 4 * sizeof(GLushort), GL_MAP_READ_BIT);
+    std::vector<uint64_t> visible;
+    if (pixels)
+    {
+        for (int i = 0; i < fbWidth * fbHeight; i++)
+        {
+            const GLushort *p = pixels + 4 * i;
+            if (p[3] > 0 && p[3] <= (int)surfaces.size())
+                visible.push_back(tileKey(p[3], p[2], p[0], p[1]));
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    std::sort(visible.begin(), visible.end());
+    visible.erase(std::unique(visible.begin(), visible.end()), visible.end());
+
+    // 标记可见分页及其祖先为最近使用，缺失的分页加入待加载列表
+    std::vector<uint64_t> missing;
+    for (uint64_t key : visible)
+    {
+        int id, level, x, y;
+        splitKey(key, id, level, x, y);
+        Surface &s = surfaces[id - 1];
+        if (level >= s.levels || x >= (s.pagesX >> level) || y >= (s.pagesY >> level))
+            continue;
+        for (int l = level; l < s.levels; l++, x >>= 1, y >>= 1)
+        {
+            int slot = s.resident[l][y * (s.pagesX >> l) + x];
+            if (slot >= 0)
+                slots[slot].lastUsed = frame;
+            else
+                missing.push_back(tileKey(id, l, x, y));
+        }
+    }
+    std::sort(missing.begin(), missing.end());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+    // 粗级别优先加载，先得到模糊结果再逐步细化
+    std::stable_sort(missing.begin(), missing.end(), [](uint64_t a, uint64_t b) {
+        return ((a >> 40) & 0xff) > ((b >> 40) & 0xff);
+    });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint64_t key : missing)
+    {
+        if (pending.size() >= MAX_PENDING)
+            break;
+        if (failed.count(key) || !pending.insert(key).second)
+            continue;
+        int id, level, x, y;
+        splitKey(key, id, level, x, y);
+        requests.push_back({key, tilePath(surfaces[id - 1], level, x, y)});
+    }
+    cv.notify_all();
+}
+
+int VirtualTexture::allocSlot(bool locked)
+{
+    // 优先使用空槽位，否则淘汰本帧未使用且最久未使用的分页
+    int best = -1;
+    for (int i = 0; i < (int)slots.size(); i++)
+    {
+        if (slots[i].surface < 0)
+        {
+            best = i;
+            break;
+        }
+        if (!slots[i].locked && slots[i].lastUsed < frame && (best < 0 || slots[i].lastUsed < slots[best].lastUsed))
+            best = i;
+    }
+    if (best < 0)
+        return -1;
+    Slot &slot = slots[best];
+    if (slot.surface > 0)
+    {
+        Surface &s = surfaces[slot.surface - 1];
+        s.resident[slot.level][slot.y * (s.pagesX >> slot.level) + slot.x] = -1;
+        s.dirty = true;
+    }
+    slot = Slot();
+    slot.locked = locked;
+    return best;
+}
+
+void VirtualTexture::upload(int slot, int surface, int level, int x, int y, const unsigned char *data)
+{
+    slots[slot].surface = surface;
+    slots[slot].level = level;
+    slots[slot].x = x;
+    slots[slot].y = y;
+    glBindTexture(GL_TEXTURE_2D, physTex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % slotsPerSide) * slotSize, (slot / slotsPerSide) * slotSize,
+                    slotSize, slotSize, GL_RGBA, GL_UNSIGNED_BYTE, data);
+}
+
+void VirtualTexture::rebuildTable(Surface &s)
+{
+    // 从最粗一级向下填充，缺失的分页沿用父分页的映射
+    for (int l = s.levels - 1; l >= 0; l--)
+    {
+        int w = s.pagesX >> l, h = s.pagesY >> l;
+        int parentW = s.pagesX >> (l + 1);
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                unsigned char *entry = &s.table[l][(y * w + x) * 4];
+                int slot = s.resident[l][y * w + x];
+                if (slot >= 0)
+                {
+                    entry[0] = slot % slotsPerSide;
+                    entry[1] = slot / slotsPerSide;
+                    entry[2] = l;
+                    entry[3] = 255;
+                }
+                else if (l + 1 < s.levels)
+                {
+                    const unsigned char *parent = &s.table[l + 1][((y / 2) * parentW + x / 2) * 4];
+                    std::copy(parent, parent + 4, entry);
+                }
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, s.pageTable);
+    for (int l = 0; l < s.levels; l++)
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, s.pagesX >> l, s.pagesY >> l, GL_RGBA, GL_UNSIGNED_BYTE, &s.table[l][0]);
+    }
+    s.dirty = false;
+}
+
+void VirtualTexture::bind(Shader &shader, int id)
+{
+    const Surface &s = surfaces[id - 1];
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, s.pageTable);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, physTex);
+    glActiveTexture(GL_TEXTURE0);
+    shader.setBool("virtualTex", true);
+    shader.setInt("pageTable", 1);
+    shader.setInt("physTex", 2);
+    shader.setVec2("vtPages", (float)s.pagesX, (float)s.pagesY);
+    shader.setFloat("vtPageSize", (float)pageSize);
+    shader.setFloat("vtBorder", (float)border);
+    shader.setFloat("vtMaxMip", (float)(s.levels - 1));
+    shader.setFloat("vtPhysSize", (float)(slotsPerSide * slotSize));
+}
+
+void VirtualTexture::beginFeedback(Shader &shader)
+{
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+    glViewport(0, 0, fbWidth, fbHeight);
+    GLuint clearColor[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, clearColor);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    shader.use();
+    // 反馈缓冲区分辨率较低，导数偏大，需要补偿到屏幕分辨率下的mip级别
+    shader.setFloat("mipBias", std::log2((float)fbWidth / std::max(1, savedViewport[2])));
+}
+
+void VirtualTexture::setFeedbackSurface(Shader &shader, int id)
+{
+    shader.setInt("vtId", id);
+    if (id > 0)
+    {
+        const Surface &s = surfaces[id - 1];
+        shader.setVec2("vtPages", (float)s.pagesX, (float)s.pagesY);
+        shader.setFloat("vtPageSize", (float)pageSize);
+        shader.setFloat("vtMaxMip", (float)(s.levels - 1));
+    }
+}
+
+void VirtualTexture::endFeedback()
+{
+    // update()已将frame加一，这里写入的PBO在两帧后读取
+    int index = frame % 2;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[index]);
+    glReadPixels(0, 0, fbWidth, fbHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    pboReady[index] = true;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+void VirtualTexture::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cv.notify_all();
+    for (auto &t : workers)
+        t.join();
+    workers.clear();
+    requests.clear();
+    for (const Tile &t : done)
+        stbi_image_free(t.data);
+    done.clear();
+    pending.clear();
+    failed.clear();
+
+    for (Surface &s : surfaces)
+        glDeleteTextures(1, &s.pageTable);
+    surfaces.clear();
+    glDeleteTextures(1, &physTex);
+    glDeleteBuffers(2, pbo);
+    glDeleteRenderbuffers(1, &feedbackColor);
+    glDeleteRenderbuffers(1, &feedbackDepth);
+    glDeleteFramebuffers(1, &feedbackFBO);
+    physTex = feedbackFBO = feedbackColor = feedbackDepth = 0;
+    pbo[0] = pbo[1] = 0;
+    pboReady[0] = pboReady[1] = false;
+}
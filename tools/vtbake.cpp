@@ -0,0 +1,334 @@
+// 将大图切成虚拟纹理使用的分页mip金字塔
+// 输出目录结构：<outdir>/info.txt, <outdir>/<级别>/<x>_<y>.jpg
+// 每个分页四周带border像素的边框（横向环绕、纵向截断），保证物理缓存中的双线性过滤不跨页
+// 原图可以是一张图，也可以是cols x rows张拼接的小图（超过stb_image单张上限的地图需要拆开），
+// 按分页行流式处理：内存中只保留正在使用的一两行原图和每一级的三行分页
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image.h>
+#include <stb/stb_image_write.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::vector<unsigned char> Strip; // 一行分页的RGB数据（不含边框），第0行为底部
+
+static int nextPow2(int x)
+{
+    int p = 1;
+    while (p < x)
+        p *= 2;
+    return p;
+}
+
+// 拼接的原图，按需解码整行小图，横向环绕、纵向截断
+class Mosaic
+{
+public:
+    int cols, rows, tileW, tileH;
+    std::vector<std::string> paths; // 从左上角开始按行排列
+
+    ~Mosaic()
+    {
+        for (unsigned char *img : images)
+            stbi_image_free(img);
+    }
+
+    bool open()
+    {
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            int w, h, c;
+            if (!stbi_info(paths[i].c_str(), &w, &h, &c))
+            {
+                std::cout << "ERROR::VTBAKE::IMAGE_NOT_LOADED: " << paths[i] << std::endl;
+                return false;
+            }
+            if (i == 0)
+            {
+                tileW = w;
+                tileH = h;
+            }
+            else if (w != tileW || h != tileH)
+            {
+                std::cout << "ERROR::VTBAKE::IMAGE_SIZE_MISMATCH: " << paths[i] << std::endl;
+                return false;
+            }
+        }
+        images.assign(paths.size(), NULL);
+        return true;
+    }
+    int width() const { return cols * tileW; }
+    int height() const { return rows * tileH; }
+
+    // 保证覆盖[y0, y1]（自底向上的行号）的小图已解码，释放其他行
+    bool require(int y0, int y1)
+    {
+        int r0 = y0 / tileH, r1 = y1 / tileH;
+        for (int r = 0; r < rows; r++)
+        {
+            for (int c = 0; c < cols; c++)
+            {
+                unsigned char *&img = images[r * cols + c];
+                if (r < r0 || r > r1)
+                {
+                    stbi_image_free(img);
+                    img = NULL;
+                }
+                else if (!img)
+                {
+                    // images按自底向上的行存放，paths按自顶向下
+                    int w, h, n;
+                    const std::string &path = paths[(rows - 1 - r) * cols + c];
+                    img = stbi_load(path.c_str(), &w, &h, &n, 3);
+                    if (!img)
+                    {
+                        std::cout << "ERROR::VTBAKE::IMAGE_NOT_LOADED: " << path << std::endl;
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+    const unsigned char *pixel(int x, int y) const
+    {
+        int c = x / tileW, r = y / tileH;
+        return images[r * cols + c] + ((size_t)(y - r * tileH) * tileW + (x - c * tileW)) * 3;
+    }
+
+private:
+    std::vector<unsigned char *> images;
+};
+
+// 把原图双线性缩放成第0级的第py行分页，横向环绕
+static bool resampleStrip(Mosaic &src, int py, int pageSize, int width, int height, Strip &out)
+{
+    int w = src.width(), h = src.height();
+    auto srcRow = [&](int y) { return std::max(0.0f, std::min((float)h - 1, (y + 0.5f) * h / height - 0.5f)); };
+    int firstRow = (int)srcRow(py * pageSize);
+    int lastRow = std::min(h - 1, (int)srcRow(py * pageSize + pageSize - 1) + 1);
+    if (!src.require(firstRow, lastRow))
+        return false;
+
+    out.resize((size_t)width * pageSize * 3);
+    for (int j = 0; j < pageSize; j++)
+    {
+        float fy = srcRow(py * pageSize + j);
+        int y0 = (int)fy, y1 = std::min(h - 1, y0 + 1);
+        float ty = fy - y0;
+        for (int x = 0; x < width; x++)
+        {
+            float fx = (x + 0.5f) * w / width - 0.5f;
+            int x0 = (int)std::floor(fx);
+            float tx = fx - x0;
+            int x1 = (x0 + 1) % w;
+            x0 = (x0 % w + w) % w;
+            const unsigned char *p00 = src.pixel(x0, y0), *p10 = src.pixel(x1, y0);
+            const unsigned char *p01 = src.pixel(x0, y1), *p11 = src.pixel(x1, y1);
+            for (int c = 0; c < 3; c++)
+            {
+                float a = p00[c] * (1 - tx) + p10[c] * tx;
+                float b = p01[c] * (1 - tx) + p11[c] * tx;
+                out[((size_t)j * width + x) * 3 + c] = (unsigned char)(a * (1 - ty) + b * ty + 0.5f);
+            }
+        }
+    }
+    return true;
+}
+
+// 一级分页的流式写出：依次接收每行分页，凑齐上下相邻行后写出带边框的分页，
+// 同时把每两行2x2盒式滤波成下一级的一行
+class LevelWriter
+{
+public:
+    LevelWriter(const std::string &dir, int width, int pagesY, int pageSize, int border, int quality, LevelWriter *next)
+        : dir(dir), width(width), pagesY(pagesY), pageSize(pageSize), border(border), quality(quality), next(next)
+    {
+        std::filesystem::create_directories(dir);
+    }
+
+    bool push(Strip strip)
+    {
+        window.push_back(std::move(strip));
+        received++;
+        if (next && received % 2 == 0 && !next->push(downsample(window[window.size() - 2], window.back())))
+            return false;
+        if (received >= 2 && !writeRow(received - 2))
+            return false;
+        if (window.size() > 3)
+            window.erase(window.begin());
+        return true;
+    }
+
+    bool finish()
+    {
+        if (!writeRow(received - 1))
+            return false;
+        return next ? next->finish() : true;
+    }
+
+private:
+    std::string dir;
+    int width, pagesY, pageSize, border, quality;
+    LevelWriter *next;
+    std::vector<Strip> window; // 最近收到的至多三行
+    int received = 0;
+
+    // 第row行在window中的数据
+    const Strip &strip(int row) const
+    {
+        return window[window.size() - (received - row)];
+    }
+
+    Strip downsample(const Strip &lower, const Strip &upper) const
+    {
+        int w = width / 2;
+        Strip out((size_t)w * pageSize * 3);
+        for (int j = 0; j < pageSize; j++)
+        {
+            // 两行拼起来共2*pageSize行，输出第j行取其中第2j、2j+1行
+            const Strip &s = 2 * j < pageSize ? lower : upper;
+            int line = (2 * j) % pageSize;
+            for (int x = 0; x < w; x++)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    int sum = s[((size_t)line * width + 2 * x) * 3 + c] + s[((size_t)line * width + 2 * x + 1) * 3 + c] +
+                              s[((size_t)(line + 1) * width + 2 * x) * 3 + c] + s[((size_t)(line + 1) * width + 2 * x + 1) * 3 + c];
+                    out[((size_t)j * w + x) * 3 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        return out;
+    }
+
+    // 多线程写出第row行的所有分页
+    bool writeRow(int row)
+    {
+        int pagesX = width / pageSize;
+        int slotSize = pageSize + 2 * border;
+        int lastLine = pagesY * pageSize - 1;
+        std::atomic<int> nextPage(0);
+        std::atomic<bool> ok(true);
+        auto work = [&]() {
+            std::vector<unsigned char> tile((size_t)slotSize * slotSize * 3);
+            for (int px = nextPage++; px < pagesX; px = nextPage++)
+            {
+                for (int j = 0; j < slotSize; j++)
+                {
+                    int line = std::max(0, std::min(lastLine, row * pageSize + j - border));
+                    const Strip &s = strip(line / pageSize);
+                    const unsigned char *src = &s[(size_t)(line % pageSize) * width * 3];
+                    for (int k = 0; k < slotSize; k++)
+                    {
+                        int sx = ((px * pageSize + k - border) % width + width) % width;
+                        std::memcpy(&tile[((size_t)j * slotSize + k) * 3], src + (size_t)sx * 3, 3);
+                    }
+                }
+                std::string path = dir + "/" + std::to_string(px) + "_" + std::to_string(row) + ".jpg";
+                if (!stbi_write_jpg(path.c_str(), slotSize, slotSize, 3, &tile[0], quality))
+                {
+                    std::cout << "ERROR::VTBAKE::WRITE_FAILED: " << path << std::endl;
+                    ok = false;
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        unsigned int threads = std::min<unsigned int>(pagesX, std::max(1u, std::thread::hardware_concurrency()));
+        for (unsigned int t = 1; t < threads; t++)
+            pool.emplace_back(work);
+        work();
+        for (auto &t : pool)
+            t.join();
+        return ok;
+    }
+};
+
+static void usage()
+{
+    std::cout << "usage: VTBake [-page 128] [-border 4] [-quality 90] <outdir> <image>" << std::endl;
+    std::cout << "       VTBake [-page 128] [-border 4] [-quality 90] -grid <cols> <rows> <outdir> <image>..." << std::endl;
+    std::cout << "grid images are listed row by row starting from the top-left and must share one size" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int pageSize = 128, border = 4, quality = 90;
+    Mosaic src;
+    src.cols = src.rows = 1;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2)
+    {
+        std::string opt = argv[i];
+        if (opt == "-page")
+            pageSize = std::atoi(argv[i + 1]);
+        else if (opt == "-border")
+            border = std::atoi(argv[i + 1]);
+        else if (opt == "-quality")
+            quality = std::atoi(argv[i + 1]);
+        else if (opt == "-grid" && i + 2 < argc)
+        {
+            src.cols = std::atoi(argv[i + 1]);
+            src.rows = std::atoi(argv[i + 2]);
+            i++;
+        }
+        else
+        {
+            usage();
+            return -1;
+        }
+    }
+    if (src.cols <= 0 || src.rows <= 0 || pageSize <= 0 || pageSize % 2 != 0 || border < 0 || border > pageSize ||
+        argc - i != 1 + src.cols * src.rows)
+    {
+        usage();
+        return -1;
+    }
+    std::string outDir = argv[i];
+    src.paths.assign(argv + i + 1, argv + argc);
+
+    // 与程序中的加载方式保持一致：第0行为图像底部
+    stbi_set_flip_vertically_on_load(true);
+    stbi_flip_vertically_on_write(1);
+    if (!src.open())
+        return -1;
+
+    // 第0级的页数取2的幂，保证每一级都能整除
+    int w = src.width(), h = src.height();
+    int pagesX = nextPow2((w + pageSize - 1) / pageSize);
+    int pagesY = nextPow2((h + pageSize - 1) / pageSize);
+    int levels = 1;
+    while ((pagesX >> levels) > 0 && (pagesY >> levels) > 0)
+        levels++;
+    std::cout << "Tex " << w << "x" << h << " -> " << pagesX << "x" << pagesY << " pages, " << levels << " levels" << std::endl;
+
+    std::vector<std::unique_ptr<LevelWriter>> writers(levels);
+    for (int l = levels - 1; l >= 0; l--)
+    {
+        LevelWriter *next = l + 1 < levels ? writers[l + 1].get() : NULL;
+        writers[l].reset(new LevelWriter(outDir + "/" + std::to_string(l), (pagesX >> l) * pageSize, pagesY >> l,
+                                         pageSize, border, quality, next));
+    }
+
+    Strip strip;
+    for (int py = 0; py < pagesY; py++)
+    {
+        if (!resampleStrip(src, py, pageSize, pagesX * pageSize, pagesY * pageSize, strip) || !writers[0]->push(strip))
+            return -1;
+    }
+    if (!writers[0]->finish())
+        return -1;
+
+    std::ofstream info(outDir + "/info.txt");
+    info << pageSize << " " << border << " " << pagesX << " " << pagesY << " " << levels << std::endl;
+    return 0;
+}
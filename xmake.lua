@@ -9,6 +9,32 @@ target("SolarSysModel")
     add_files("src/*.cpp")
     add_packages("glfw","glad","stb","glm")
     add_includedirs("include")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+
+-- 碰撞检测性能测试：空间哈希 vs 暴力检测
+target("CollisionBench")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/collision_bench.cpp", "src/collision.cpp")
+    add_packages("glm")
+    add_includedirs("include")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+
+-- 虚拟纹理切片工具
+target("VTBake")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++17")
+    set_rundir("$(projectdir)")
+    add_files("tools/vtbake.cpp", "src/stb_image.cpp")
+    add_packages("stb")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
 --